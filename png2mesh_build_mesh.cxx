@@ -8,8 +8,12 @@
 #include <t8_cmesh.h>
 #include <t8_cmesh/t8_cmesh_examples.h>
 #include <t8_schemes/t8_default/t8_default.hxx>
+#include <t8_vtk.h>
 #include <assert.h>
+#include <math.h>
 #include "png2mesh_readpng.h"
+#include "png2mesh_image_stats.h"
+#include "png2mesh_labels.h"
 
 typedef struct
 {
@@ -18,6 +22,7 @@ typedef struct
   int                 threshold;        /* r+g+b threshold for refinement. 0 <= values <= 3*255 */
   bool                invert;   /* If true, refine bright areas, not dark. */
   sc_array_t          refinement_markers;       /* For each element 1 if it should be refined, 0 if not. */
+  const png2mesh_image_stats_t *stats;  /* Summed-area tables of the image for the per-element output and the label mode. */
 } png2mesh_adapt_context_t;
 
 int
@@ -102,6 +107,259 @@ png2mesh_element_has_dark_pixel (t8_forest_t forest, t8_locidx_t ltreeid,
   return 0;
 }
 
+/* Compute the range [start, end) of pixels whose centers lie in
+ * the interval [lo, hi), given in pixel units. */
+void
+png2mesh_pixel_range (const double lo, const double hi, const int num_pixels,
+                      int *start, int *end)
+{
+  *start = SC_MAX (0, (int) ceil (lo - 0.5));
+  *end = SC_MIN (num_pixels, (int) ceil (hi - 0.5));
+}
+
+/* Callback that adds the pixels x_start <= x < x_end, y_start <= y < y_end to a region. */
+typedef void        (*png2mesh_add_rect_fn) (const png2mesh_image_stats_t *
+                                             stats, int x_start, int y_start,
+                                             int x_end, int y_end,
+                                             void *region);
+
+/* Add all pixels whose centers lie inside an element to a region.
+ * Our quads are axis aligned and cover exactly one rectangle of pixels,
+ * triangles are added as one rectangle per pixel row.
+ * If the element is smaller than a pixel, we add the pixel containing its centroid. */
+void
+png2mesh_element_footprint (t8_forest_t forest, t8_locidx_t ltreeid,
+                            const t8_element_t *element,
+                            const t8_scheme *scheme,
+                            const png2mesh_image_stats_t *stats,
+                            png2mesh_add_rect_fn add_rect, void *region)
+{
+  const png2mesh_image_t *image = stats->image;
+  double              coords[3];
+  double              vertices_x[4], vertices_y[4];
+  double              x_min, x_max, y_min, y_max;
+  int                 x_start, x_end, y_start, y_end;
+  int                 ivertex, num_vertices;
+  bool                is_empty = true;
+
+  const t8_eclass_t tree_class = t8_forest_get_tree_class (forest, ltreeid);
+  const t8_element_shape_t element_shape =
+    scheme->element_get_shape (tree_class, element);
+  assert (element_shape == T8_ECLASS_TRIANGLE
+          || element_shape == T8_ECLASS_QUAD);
+  num_vertices = element_shape == T8_ECLASS_QUAD ? 4 : 3;
+
+  /* Compute the vertices and bounding box of the element in pixel units.
+   * We need to flip the y coordinate. */
+  x_min = y_min = image->width + image->height;
+  x_max = y_max = -1;
+  for (ivertex = 0; ivertex < num_vertices; ++ivertex) {
+    t8_forest_element_coordinate (forest, ltreeid, element, ivertex, coords);
+    vertices_x[ivertex] = coords[0] * image->width;
+    vertices_y[ivertex] = (1 - coords[1]) * image->height;
+    x_min = SC_MIN (x_min, vertices_x[ivertex]);
+    x_max = SC_MAX (x_max, vertices_x[ivertex]);
+    y_min = SC_MIN (y_min, vertices_y[ivertex]);
+    y_max = SC_MAX (y_max, vertices_y[ivertex]);
+  }
+  png2mesh_pixel_range (x_min, x_max, image->width, &x_start, &x_end);
+  png2mesh_pixel_range (y_min, y_max, image->height, &y_start, &y_end);
+
+  if (element_shape == T8_ECLASS_QUAD) {
+    if (x_start < x_end && y_start < y_end) {
+      add_rect (stats, x_start, y_start, x_end, y_end, region);
+      is_empty = false;
+    }
+  }
+  else {
+    /* Intersect each pixel row with the edges of the triangle. */
+    for (int iy = y_start; iy < y_end; ++iy) {
+      const double        center_y = iy + 0.5;
+      double              row_min = x_max, row_max = x_min;
+      int                 row_start, row_end;
+      for (ivertex = 0; ivertex < 3; ++ivertex) {
+        const int           inext = (ivertex + 1) % 3;
+        const double        ya = vertices_y[ivertex], yb = vertices_y[inext];
+        const double        xa = vertices_x[ivertex], xb = vertices_x[inext];
+        if (center_y < SC_MIN (ya, yb) || SC_MAX (ya, yb) < center_y) {
+          /* This edge does not cross the row. */
+          continue;
+        }
+        if (ya == yb) {
+          row_min = SC_MIN (row_min, SC_MIN (xa, xb));
+          row_max = SC_MAX (row_max, SC_MAX (xa, xb));
+        }
+        else {
+          const double        x = xa + (center_y - ya) * (xb - xa) / (yb - ya);
+          row_min = SC_MIN (row_min, x);
+          row_max = SC_MAX (row_max, x);
+        }
+      }
+      png2mesh_pixel_range (row_min, row_max, image->width, &row_start,
+                            &row_end);
+      if (row_start < row_end) {
+        add_rect (stats, row_start, iy, row_end, iy + 1, region);
+        is_empty = false;
+      }
+    }
+  }
+  if (is_empty) {
+    /* The element does not contain any pixel center. */
+    t8_forest_element_centroid (forest, ltreeid, element, coords);
+    const int           pixel_x =
+      SC_MAX (0, SC_MIN (image->width - 1, (int) (coords[0] * image->width)));
+    const int           pixel_y =
+      SC_MAX (0, SC_MIN (image->height - 1,
+                         (int) ((1 - coords[1]) * image->height)));
+    add_rect (stats, pixel_x, pixel_y, pixel_x + 1, pixel_y + 1, region);
+  }
+}
+
+void
+png2mesh_add_rect_stats (const png2mesh_image_stats_t *stats, int x_start,
+                         int y_start, int x_end, int y_end, void *region)
+{
+  png2mesh_image_stats_add_rect (stats, x_start, y_start, x_end, y_end,
+                                 (png2mesh_region_stats_t *) region);
+}
+
+/* Compute the statistics of all pixels whose centers lie inside an element.
+ * For quads, the sums take constant time and the min/max one lookup per
+ * block of the min/max tables (see PNG2MESH_STATS_MAX_BLOCK_LEVEL). */
+void
+png2mesh_element_stats (t8_forest_t forest, t8_locidx_t ltreeid,
+                        const t8_element_t *element,
+                        const t8_scheme *scheme,
+                        const png2mesh_image_stats_t *stats,
+                        png2mesh_region_stats_t *region)
+{
+  png2mesh_region_stats_init (region);
+  png2mesh_element_footprint (forest, ltreeid, element, scheme, stats,
+                              png2mesh_add_rect_stats, region);
+}
+
+void
+png2mesh_add_rect_labels (const png2mesh_image_stats_t *stats, int x_start,
+                          int y_start, int x_end, int y_end, void *region)
+{
+  png2mesh_image_stats_add_label_rect (stats, x_start, y_start, x_end, y_end,
+                                       (png2mesh_label_region_t *) region);
+}
+
+/* Compute the label statistics of all pixels whose centers lie inside an element.
+ * This is all we need to decide the refinement in label mode. */
+void
+png2mesh_element_label_stats (t8_forest_t forest, t8_locidx_t ltreeid,
+                              const t8_element_t *element,
+                              const t8_scheme *scheme,
+                              const png2mesh_image_stats_t *stats,
+                              png2mesh_label_region_t *region)
+{
+  png2mesh_label_region_init (region);
+  png2mesh_element_footprint (forest, ltreeid, element, scheme, stats,
+                              png2mesh_add_rect_labels, region);
+}
+
+void
+png2mesh_add_rect_label_counts (const png2mesh_image_stats_t *stats,
+                                int x_start, int y_start, int x_end,
+                                int y_end, void *label_counts)
+{
+  png2mesh_image_stats_count_labels (stats, x_start, y_start, x_end, y_end,
+                                     (uint64_t *) label_counts);
+}
+
+/* Return the label with the most pixels in an element.
+ * This counts each pixel of the element and is only used for the output. */
+int
+png2mesh_element_dominant_label (t8_forest_t forest, t8_locidx_t ltreeid,
+                                 const t8_element_t *element,
+                                 const t8_scheme *scheme,
+                                 const png2mesh_image_stats_t *stats)
+{
+  uint64_t            label_counts[PNG2MESH_MAX_LABELS] = { 0 };
+
+  png2mesh_element_footprint (forest, ltreeid, element, scheme, stats,
+                              png2mesh_add_rect_label_counts, label_counts);
+  return png2mesh_dominant_label (label_counts, stats->num_labels);
+}
+
+/* Write a forest to vtu files together with the per-element
+ * mean RGB, coverage fraction of matching pixels and min/max r+g+b
+ * as cell data. */
+void
+png2mesh_write_vtk (t8_forest_t forest, const char *vtuname,
+                    const png2mesh_image_stats_t *stats)
+{
+  const t8_scheme    *scheme = t8_forest_get_scheme (forest);
+  const t8_locidx_t   num_elements =
+    t8_forest_get_local_num_leaf_elements (forest);
+  const t8_locidx_t   num_trees = t8_forest_get_num_local_trees (forest);
+  double             *mean_rgb = T8_ALLOC (double, 3 * num_elements);
+  double             *coverage = T8_ALLOC (double, num_elements);
+  double             *min_intensity = T8_ALLOC (double, num_elements);
+  double             *max_intensity = T8_ALLOC (double, num_elements);
+  double             *dominant_label = NULL;
+  t8_vtk_data_field_t vtk_data[5];
+  int                 num_data = 4;
+  t8_locidx_t         itree, ielement, element_index = 0;
+  png2mesh_region_stats_t region;
+
+  if (stats->labels != NULL) {
+    dominant_label = T8_ALLOC (double, num_elements);
+  }
+  for (itree = 0; itree < num_trees; ++itree) {
+    const t8_locidx_t   num_tree_elements =
+      t8_forest_get_tree_num_leaf_elements (forest, itree);
+    for (ielement = 0; ielement < num_tree_elements;
+         ++ielement, ++element_index) {
+      const t8_element_t *element =
+        t8_forest_get_leaf_element_in_tree (forest, itree, ielement);
+      png2mesh_element_stats (forest, itree, element, scheme, stats, &region);
+      if (dominant_label != NULL) {
+        dominant_label[element_index] =
+          png2mesh_element_dominant_label (forest, itree, element, scheme,
+                                           stats);
+      }
+      for (int icolor = 0; icolor < 3; ++icolor) {
+        mean_rgb[3 * element_index + icolor] =
+          region.sum_rgb[icolor] / (double) region.num_pixels;
+      }
+      coverage[element_index] =
+        region.num_matches / (double) region.num_pixels;
+      min_intensity[element_index] = region.min_intensity;
+      max_intensity[element_index] = region.max_intensity;
+    }
+  }
+
+  vtk_data[0].type = T8_VTK_VECTOR;
+  snprintf (vtk_data[0].description, BUFSIZ, "mean_rgb");
+  vtk_data[0].data = mean_rgb;
+  vtk_data[1].type = T8_VTK_SCALAR;
+  snprintf (vtk_data[1].description, BUFSIZ, "coverage");
+  vtk_data[1].data = coverage;
+  vtk_data[2].type = T8_VTK_SCALAR;
+  snprintf (vtk_data[2].description, BUFSIZ, "min_rgb_sum");
+  vtk_data[2].data = min_intensity;
+  vtk_data[3].type = T8_VTK_SCALAR;
+  snprintf (vtk_data[3].description, BUFSIZ, "max_rgb_sum");
+  vtk_data[3].data = max_intensity;
+  if (dominant_label != NULL) {
+    vtk_data[4].type = T8_VTK_SCALAR;
+    snprintf (vtk_data[4].description, BUFSIZ, "label");
+    vtk_data[4].data = dominant_label;
+    num_data = 5;
+  }
+  t8_forest_write_vtk_ext (forest, vtuname, 1, 1, 1, 1, 0, 0, 0, num_data,
+                           vtk_data);
+
+  T8_FREE (mean_rgb);
+  T8_FREE (coverage);
+  T8_FREE (min_intensity);
+  T8_FREE (max_intensity);
+  T8_FREE (dominant_label);
+}
+
 int
 png2mesh_search_callback ([[maybe_unused]]t8_forest_t forest,
                           [[maybe_unused]]const t8_locidx_t ltreeid,
@@ -251,6 +509,55 @@ png2mesh_build_query_array (sc_array_t *queries,
             num_pixels);
 }
 
+/* Build the mask of all pixels that match the condition.
+ * One value per pixel in row major order, 1 if the pixel matches, 0 if not. */
+unsigned char *
+png2mesh_build_match_mask (const png2mesh_image_t * image, const bool invert,
+                           const int threshold)
+{
+  unsigned char      *match_mask =
+    T8_ALLOC (unsigned char, (size_t) image->width * image->height);
+  int                 x, y;
+
+  for (y = 0; y < image->height; ++y) {
+    for (x = 0; x < image->width; ++x) {
+      match_mask[(size_t) y * image->width + x] =
+        png2mesh_pixel_match (image, x, y, invert, threshold);
+    }
+  }
+  return match_mask;
+}
+
+/* Label mode: Mark all elements for refinement that contain more than
+ * one label (material interfaces) or the label stats->refine_label. */
+void
+png2mesh_mark_label_elements (t8_forest_t forest,
+                              const png2mesh_adapt_context_t * adapt_context)
+{
+  const t8_scheme    *scheme = t8_forest_get_scheme (forest);
+  const t8_locidx_t   num_trees = t8_forest_get_num_local_trees (forest);
+  const png2mesh_image_stats_t *stats = adapt_context->stats;
+  t8_locidx_t         itree, ielement, element_index = 0;
+  png2mesh_label_region_t region;
+
+  for (itree = 0; itree < num_trees; ++itree) {
+    const t8_locidx_t   num_tree_elements =
+      t8_forest_get_tree_num_leaf_elements (forest, itree);
+    for (ielement = 0; ielement < num_tree_elements;
+         ++ielement, ++element_index) {
+      const t8_element_t *element =
+        t8_forest_get_leaf_element_in_tree (forest, itree, ielement);
+      png2mesh_element_label_stats (forest, itree, element, scheme, stats,
+                                    &region);
+      if (png2mesh_label_region_refine (&region)) {
+        *(int *) t8_sc_array_index_locidx ((sc_array_t *)
+                                           &adapt_context->refinement_markers,
+                                           element_index) = 1;
+      }
+    }
+  }
+}
+
 /*
  * element_choice: 0 - quad
  *				   1 - triangle
@@ -293,11 +600,20 @@ build_forest (int level, int element_choice, sc_MPI_Comm comm,
   t8_forest_t         forest_balance;
   sc_array_t          search_queries;
   char                vtuname[BUFSIZ];
+  char                criterion_string[BUFSIZ];
   int                 ilevel;
+  const bool          label_mode = adapt_context->stats->labels != NULL;
 
   sc_array_init ((sc_array_t *) &adapt_context->refinement_markers,
                  sizeof (int));
-  png2mesh_build_query_array (&search_queries, adapt_context, mpirank);
+  if (label_mode) {
+    /* The label mode reads the labels of each element from the
+     * summed-area tables and does not need search queries. */
+    sc_array_init (&search_queries, sizeof (int));
+  }
+  else {
+    png2mesh_build_query_array (&search_queries, adapt_context, mpirank);
+  }
   for (ilevel = level; ilevel < adapt_context->maxlevel; ++ilevel) {
     t8_forest_set_user_data (forest, (void *) adapt_context);
     /* Fill adapt markers array */
@@ -312,9 +628,14 @@ build_forest (int level, int element_choice, sc_MPI_Comm comm,
                                          &adapt_context->refinement_markers,
                                          ielement) = 0;
     }
-    /* Search and create the refinement markers. */
-    t8_forest_search (forest, png2mesh_search_callback,
-                      png2mesh_query_callback, &search_queries);
+    if (label_mode) {
+      png2mesh_mark_label_elements (forest, adapt_context);
+    }
+    else {
+      /* Search and create the refinement markers. */
+      t8_forest_search (forest, png2mesh_search_callback,
+                        png2mesh_query_callback, &search_queries);
+    }
     t8_forest_init (&forest_adapt);
     t8_forest_set_adapt (forest_adapt, forest, png2mesh_adapt, 0);
     t8_forest_set_partition (forest_adapt, forest, 0);
@@ -324,33 +645,39 @@ build_forest (int level, int element_choice, sc_MPI_Comm comm,
   sc_array_reset ((sc_array_t *) &adapt_context->refinement_markers);
   sc_array_reset (&search_queries);
 
+  if (label_mode) {
+    snprintf (criterion_string, BUFSIZ, "labels");
+  }
+  else {
+    snprintf (criterion_string, BUFSIZ, "t%i", adapt_context->threshold);
+  }
   sreturn =
-    snprintf (vtuname, BUFSIZ, "t8_png_adapt_%s_%s_t%i",
+    snprintf (vtuname, BUFSIZ, "t8_png_adapt_%s_%s_%s",
               basename ((char *) adapt_context->image->filename),
-              element_string, adapt_context->threshold);
+              element_string, criterion_string);
   if (sreturn >= BUFSIZ) {
     /* String was truncated. */
     /* Note: gcc >= 7.1 prints a warning if we 
      * do not check the return value of snprintf. */
     t8_debugf ("Warning: Truncated output string to '%s'\n", vtuname);
   }
-  t8_forest_write_vtk (forest, vtuname);
+  png2mesh_write_vtk (forest, vtuname, adapt_context->stats);
 
   t8_forest_init (&forest_balance);
   t8_forest_set_balance (forest_balance, forest, 0);
   t8_forest_commit (forest_balance);
 
   sreturn =
-    snprintf (vtuname, BUFSIZ, "t8_png_balance_%s_%s_t%i",
+    snprintf (vtuname, BUFSIZ, "t8_png_balance_%s_%s_%s",
               basename ((char *) adapt_context->image->filename),
-              element_string, adapt_context->threshold);
+              element_string, criterion_string);
   if (sreturn >= BUFSIZ) {
     /* String was truncated. */
     /* Note: gcc >= 7.1 prints a warning if we 
      * do not check the return value of snprintf. */
     t8_debugf ("Warning: Truncated output string to '%s'\n", vtuname);
   }
-  t8_forest_write_vtk (forest_balance, vtuname);
+  png2mesh_write_vtk (forest_balance, vtuname, adapt_context->stats);
 
   if (mpirank == 0) {
     printf ("\n[png2mesh] Successfully build AMR mesh for picture %s.\n",
@@ -373,9 +700,13 @@ main (int argc, char *argv[])
   int                 element_choice = 0;
   int                 invert_int = 0;
   bool                invert = false;
+  int                 refine_label = -1;
+  int                 palette_valid;
+  png2mesh_palette_t  palette;
   png2mesh_image_t   *pngimage;
   sc_options_t       *opt;
   const char         *filename;
+  const char         *palette_string;
   const char         *help =
     "The program reads a png file and builds an adaptive mesh from it.\n"
     " The mesh is refined in the dark regions of the image.";
@@ -410,8 +741,22 @@ main (int argc, char *argv[])
                       "\t\t\t 0: quad\n"
                       "\t\t\t 1: triangle\n"
                       "\t\t\t 2: quad/triangle hybrid");
+  sc_options_add_string (opt, 'L', "labels", &palette_string, "",
+                         "Label mode. A list of colors R,G,B:R,G,B:...\n"
+                         "\t\t\t\t\tPixels of the i-th color get label i, all other pixels label 0.\n"
+                         "\t\t\t\t\tThe mesh is refined where elements contain more than one label.");
+  sc_options_add_int (opt, 'T', "label_tolerance", &palette.tolerance, 0,
+                      "Label mode: Maximum difference per RGB channel for a pixel to match a color. Default 0.");
+  sc_options_add_int (opt, 'r', "refine_label", &refine_label, -1,
+                      "Label mode: Also refine all elements containing this label. Default -1 (none).");
 
   parsed = sc_options_parse (-1, SC_LP_ERROR, opt, argc, argv);
+  palette_valid = png2mesh_parse_palette (palette_string, &palette) == 0
+    && 0 <= palette.tolerance && palette.tolerance <= 255
+    && -1 <= refine_label && refine_label <= palette.num_colors
+    /* -T and -r are only valid in label mode. */
+    && (palette.num_colors > 0
+        || (palette.tolerance == 0 && refine_label == -1));
   if (helpme) {
     /* display help message and usage */
     t8_global_productionf ("%s\n", help);
@@ -419,7 +764,8 @@ main (int argc, char *argv[])
   }
   else if (parsed >= 0 && 0 <= level && strcmp (filename, "") &&
            (element_choice >= 0 && element_choice <= 2)
-           && level <= maxlevel && 0 <= threshold && threshold <= 3 * 255) {
+           && level <= maxlevel && 0 <= threshold && threshold <= 3 * 255
+           && palette_valid) {
     pngimage = png2mesh_read_png (filename);
 
     int mpirank;
@@ -433,11 +779,28 @@ main (int argc, char *argv[])
     png2mesh_adapt_context_t adapt_context;
     invert = invert_int != 0;
     if (pngimage != NULL) {
+      /* Build the summed-area tables once for the per-element output
+       * and in label mode for the refinement. */
+      unsigned char      *match_mask =
+        png2mesh_build_match_mask (pngimage, invert, threshold);
+      unsigned char      *labels = palette.num_colors > 0 ?
+        png2mesh_build_label_image (pngimage, &palette) : NULL;
+      SC_CHECK_ABORT (palette.num_colors == 0 || labels != NULL,
+                      "[png2mesh] ERROR: Could not build label image.");
+      png2mesh_image_stats_t *stats =
+        png2mesh_image_stats_new (pngimage, match_mask, labels,
+                                  palette.num_colors + 1, refine_label);
+      SC_CHECK_ABORT (stats != NULL,
+                      "[png2mesh] ERROR: Could not build image statistics.");
       adapt_context.image = pngimage;
       adapt_context.invert = invert;
       adapt_context.maxlevel = maxlevel;
       adapt_context.threshold = threshold;
+      adapt_context.stats = stats;
       build_forest (level, element_choice, sc_MPI_COMM_WORLD, &adapt_context, mpirank);
+      png2mesh_image_stats_destroy (stats);
+      T8_FREE (match_mask);
+      free (labels);
       png2mesh_image_cleanup (pngimage);
     }
   }
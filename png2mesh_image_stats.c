@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "png2mesh_image_stats.h"
+
+static int
+png2mesh_pixel_intensity (const png2mesh_image_t *image, const int x,
+                          const int y)
+{
+  png_byte           *pixel = NULL;
+  png2mesh_get_rgba (image, x, y, &pixel);
+  return pixel[0] + pixel[1] + pixel[2];
+}
+
+/* Allocate a summed-area table of size (width + 1) x (height + 1). Row 0 and column 0 are zero. */
+static uint64_t    *
+png2mesh_image_stats_new_sum (const png2mesh_image_stats_t *stats)
+{
+  return (uint64_t *) calloc ((size_t) stats->stride *
+                              (stats->image->height + 1), sizeof (uint64_t));
+}
+
+png2mesh_image_stats_t *
+png2mesh_image_stats_new (const png2mesh_image_t *image,
+                          const unsigned char *match_mask,
+                          const unsigned char *labels, int num_labels,
+                          int refine_label)
+{
+  png2mesh_image_stats_t *stats;
+  const int           width = image->width;
+  const int           height = image->height;
+  const size_t        num_pixels = (size_t) width * height;
+  int                 isum, ilevel, x, y;
+
+  assert (image != NULL);
+  assert (image->rgba_values != NULL);
+  assert (match_mask != NULL);
+  assert (labels == NULL || (0 < num_labels && num_labels <= PNG2MESH_MAX_LABELS));
+  assert (labels == NULL || (-1 <= refine_label && refine_label < num_labels));
+
+  stats = (png2mesh_image_stats_t *) calloc (1, sizeof (*stats));
+  if (stats == NULL) {
+    return NULL;
+  }
+  stats->image = image;
+  stats->match_mask = match_mask;
+  stats->stride = width + 1;
+  stats->refine_label = -1;
+
+  /* Summed-area tables. */
+  for (isum = 0; isum < PNG2MESH_STATS_NUM_SUMS; ++isum) {
+    stats->sum[isum] = png2mesh_image_stats_new_sum (stats);
+    if (stats->sum[isum] == NULL) {
+      png2mesh_image_stats_destroy (stats);
+      return NULL;
+    }
+  }
+  for (y = 0; y < height; ++y) {
+    const size_t        row = (size_t) (y + 1) * stats->stride;
+    const size_t        row_above = (size_t) y * stats->stride;
+    uint64_t            row_sum[PNG2MESH_STATS_NUM_SUMS] = { 0 };
+    for (x = 0; x < width; ++x) {
+      png_byte           *pixel = NULL;
+      png2mesh_get_rgba (image, x, y, &pixel);
+      row_sum[PNG2MESH_STATS_RED] += pixel[0];
+      row_sum[PNG2MESH_STATS_GREEN] += pixel[1];
+      row_sum[PNG2MESH_STATS_BLUE] += pixel[2];
+      row_sum[PNG2MESH_STATS_MATCH] += match_mask[(size_t) y * width + x];
+      for (isum = 0; isum < PNG2MESH_STATS_NUM_SUMS; ++isum) {
+        stats->sum[isum][row + x + 1] =
+          stats->sum[isum][row_above + x + 1] + row_sum[isum];
+      }
+    }
+  }
+
+  /* Min/max tables. Level k is built from the four 2^(k-1) blocks of level k - 1. */
+  stats->num_levels = 1;
+  while (stats->num_levels <= PNG2MESH_STATS_MAX_BLOCK_LEVEL
+         && (1 << stats->num_levels) <= width
+         && (1 << stats->num_levels) <= height) {
+    stats->num_levels++;
+  }
+  stats->min_intensity =
+    (uint16_t **) calloc (stats->num_levels, sizeof (uint16_t *));
+  stats->max_intensity =
+    (uint16_t **) calloc (stats->num_levels, sizeof (uint16_t *));
+  if (stats->min_intensity == NULL || stats->max_intensity == NULL) {
+    png2mesh_image_stats_destroy (stats);
+    return NULL;
+  }
+  for (ilevel = 0; ilevel < stats->num_levels; ++ilevel) {
+    stats->min_intensity[ilevel] =
+      (uint16_t *) malloc (num_pixels * sizeof (uint16_t));
+    stats->max_intensity[ilevel] =
+      (uint16_t *) malloc (num_pixels * sizeof (uint16_t));
+    if (stats->min_intensity[ilevel] == NULL
+        || stats->max_intensity[ilevel] == NULL) {
+      png2mesh_image_stats_destroy (stats);
+      return NULL;
+    }
+  }
+  for (y = 0; y < height; ++y) {
+    for (x = 0; x < width; ++x) {
+      const uint16_t      intensity = png2mesh_pixel_intensity (image, x, y);
+      stats->min_intensity[0][(size_t) y * width + x] = intensity;
+      stats->max_intensity[0][(size_t) y * width + x] = intensity;
+    }
+  }
+  for (ilevel = 1; ilevel < stats->num_levels; ++ilevel) {
+    const int           half = 1 << (ilevel - 1);
+    const int           block = 1 << ilevel;
+    const uint16_t     *min_fine = stats->min_intensity[ilevel - 1];
+    const uint16_t     *max_fine = stats->max_intensity[ilevel - 1];
+    uint16_t           *min_coarse = stats->min_intensity[ilevel];
+    uint16_t           *max_coarse = stats->max_intensity[ilevel];
+    /* Only blocks that lie completely inside the image are valid. */
+    for (y = 0; y + block <= height; ++y) {
+      for (x = 0; x + block <= width; ++x) {
+        const size_t        i00 = (size_t) y * width + x;
+        const size_t        i01 = i00 + half;
+        const size_t        i10 = i00 + (size_t) half * width;
+        const size_t        i11 = i10 + half;
+        uint16_t            lo = min_fine[i00], hi = max_fine[i00];
+        lo = min_fine[i01] < lo ? min_fine[i01] : lo;
+        lo = min_fine[i10] < lo ? min_fine[i10] : lo;
+        lo = min_fine[i11] < lo ? min_fine[i11] : lo;
+        hi = max_fine[i01] > hi ? max_fine[i01] : hi;
+        hi = max_fine[i10] > hi ? max_fine[i10] : hi;
+        hi = max_fine[i11] > hi ? max_fine[i11] : hi;
+        min_coarse[i00] = lo;
+        max_coarse[i00] = hi;
+      }
+    }
+  }
+
+  if (labels == NULL) {
+    return stats;
+  }
+  /* Min/max tables of the labels. Level 0 is the label image itself. */
+  stats->labels = labels;
+  stats->num_labels = num_labels;
+  stats->min_label =
+    (unsigned char **) calloc (stats->num_levels, sizeof (unsigned char *));
+  stats->max_label =
+    (unsigned char **) calloc (stats->num_levels, sizeof (unsigned char *));
+  if (stats->min_label == NULL || stats->max_label == NULL) {
+    png2mesh_image_stats_destroy (stats);
+    return NULL;
+  }
+  stats->min_label[0] = (unsigned char *) labels;
+  stats->max_label[0] = (unsigned char *) labels;
+  for (ilevel = 1; ilevel < stats->num_levels; ++ilevel) {
+    const int           half = 1 << (ilevel - 1);
+    const int           block = 1 << ilevel;
+    const unsigned char *min_fine = stats->min_label[ilevel - 1];
+    const unsigned char *max_fine = stats->max_label[ilevel - 1];
+    unsigned char      *min_coarse;
+    unsigned char      *max_coarse;
+
+    stats->min_label[ilevel] = (unsigned char *) malloc (num_pixels);
+    stats->max_label[ilevel] = (unsigned char *) malloc (num_pixels);
+    if (stats->min_label[ilevel] == NULL || stats->max_label[ilevel] == NULL) {
+      png2mesh_image_stats_destroy (stats);
+      return NULL;
+    }
+    min_coarse = stats->min_label[ilevel];
+    max_coarse = stats->max_label[ilevel];
+    for (y = 0; y + block <= height; ++y) {
+      for (x = 0; x + block <= width; ++x) {
+        const size_t        i00 = (size_t) y * width + x;
+        const size_t        i01 = i00 + half;
+        const size_t        i10 = i00 + (size_t) half * width;
+        const size_t        i11 = i10 + half;
+        unsigned char       lo = min_fine[i00], hi = max_fine[i00];
+        lo = min_fine[i01] < lo ? min_fine[i01] : lo;
+        lo = min_fine[i10] < lo ? min_fine[i10] : lo;
+        lo = min_fine[i11] < lo ? min_fine[i11] : lo;
+        hi = max_fine[i01] > hi ? max_fine[i01] : hi;
+        hi = max_fine[i10] > hi ? max_fine[i10] : hi;
+        hi = max_fine[i11] > hi ? max_fine[i11] : hi;
+        min_coarse[i00] = lo;
+        max_coarse[i00] = hi;
+      }
+    }
+  }
+
+  /* Summed-area table of the refine label. */
+  if (refine_label >= 0) {
+    stats->refine_label = refine_label;
+    stats->refine_label_sum = png2mesh_image_stats_new_sum (stats);
+    if (stats->refine_label_sum == NULL) {
+      png2mesh_image_stats_destroy (stats);
+      return NULL;
+    }
+    for (y = 0; y < height; ++y) {
+      const size_t        row = (size_t) (y + 1) * stats->stride;
+      const size_t        row_above = (size_t) y * stats->stride;
+      uint64_t            row_sum = 0;
+      for (x = 0; x < width; ++x) {
+        assert (labels[(size_t) y * width + x] < num_labels);
+        row_sum += labels[(size_t) y * width + x] == refine_label;
+        stats->refine_label_sum[row + x + 1] =
+          stats->refine_label_sum[row_above + x + 1] + row_sum;
+      }
+    }
+  }
+  return stats;
+}
+
+void
+png2mesh_image_stats_destroy (png2mesh_image_stats_t *stats)
+{
+  int                 isum, ilevel;
+
+  if (stats == NULL) {
+    return;
+  }
+  for (isum = 0; isum < PNG2MESH_STATS_NUM_SUMS; ++isum) {
+    free (stats->sum[isum]);
+  }
+  free (stats->refine_label_sum);
+  for (ilevel = 0; ilevel < stats->num_levels; ++ilevel) {
+    if (stats->min_intensity != NULL) {
+      free (stats->min_intensity[ilevel]);
+    }
+    if (stats->max_intensity != NULL) {
+      free (stats->max_intensity[ilevel]);
+    }
+    /* Level 0 of the label tables is the label image, which we do not own. */
+    if (ilevel > 0 && stats->min_label != NULL) {
+      free (stats->min_label[ilevel]);
+    }
+    if (ilevel > 0 && stats->max_label != NULL) {
+      free (stats->max_label[ilevel]);
+    }
+  }
+  free (stats->min_intensity);
+  free (stats->max_intensity);
+  free (stats->min_label);
+  free (stats->max_label);
+  free (stats);
+}
+
+void
+png2mesh_region_stats_init (png2mesh_region_stats_t *region)
+{
+  memset (region, 0, sizeof (*region));
+  region->min_intensity = 3 * 255 + 1;
+  region->max_intensity = -1;
+}
+
+/* Sum of a summed-area table over the rectangle [x_start, x_end) x [y_start, y_end). */
+static uint64_t
+png2mesh_image_stats_rect_sum (const png2mesh_image_stats_t *stats,
+                               const uint64_t *sum, const int x_start,
+                               const int y_start, const int x_end,
+                               const int y_end)
+{
+  const size_t        stride = stats->stride;
+
+  return sum[y_end * stride + x_end] - sum[y_start * stride + x_end]
+    - sum[y_end * stride + x_start] + sum[y_start * stride + x_start];
+}
+
+/* The level of the min/max blocks we use to cover a rectangle:
+ * The largest level that fits into its shorter side. */
+static int
+png2mesh_image_stats_block_level (const png2mesh_image_stats_t *stats,
+                                  const int x_start, const int y_start,
+                                  const int x_end, const int y_end)
+{
+  int                 level = 0;
+
+  while (level + 1 < stats->num_levels
+         && (2 << level) <= x_end - x_start
+         && (2 << level) <= y_end - y_start) {
+    level++;
+  }
+  return level;
+}
+
+void
+png2mesh_image_stats_add_rect (const png2mesh_image_stats_t *stats,
+                               int x_start, int y_start, int x_end,
+                               int y_end, png2mesh_region_stats_t *region)
+{
+  const int           width = stats->image->width;
+  int                 level, block, tx, ty;
+
+  assert (0 <= x_start && x_end <= stats->image->width);
+  assert (0 <= y_start && y_end <= stats->image->height);
+  if (x_end <= x_start || y_end <= y_start) {
+    return;
+  }
+  region->sum_rgb[0] +=
+    png2mesh_image_stats_rect_sum (stats, stats->sum[PNG2MESH_STATS_RED], x_start,
+                                   y_start, x_end, y_end);
+  region->sum_rgb[1] +=
+    png2mesh_image_stats_rect_sum (stats, stats->sum[PNG2MESH_STATS_GREEN], x_start,
+                                   y_start, x_end, y_end);
+  region->sum_rgb[2] +=
+    png2mesh_image_stats_rect_sum (stats, stats->sum[PNG2MESH_STATS_BLUE], x_start,
+                                   y_start, x_end, y_end);
+  region->num_matches +=
+    png2mesh_image_stats_rect_sum (stats, stats->sum[PNG2MESH_STATS_MATCH], x_start,
+                                   y_start, x_end, y_end);
+  region->num_pixels += (uint64_t) (x_end - x_start) * (y_end - y_start);
+
+  /* Cover the rectangle with (possibly overlapping) blocks. */
+  level =
+    png2mesh_image_stats_block_level (stats, x_start, y_start, x_end, y_end);
+  block = 1 << level;
+  for (ty = y_start; ty < y_end; ty += block) {
+    const int           y = ty + block <= y_end ? ty : y_end - block;
+    for (tx = x_start; tx < x_end; tx += block) {
+      const int           x = tx + block <= x_end ? tx : x_end - block;
+      const size_t        index = (size_t) y * width + x;
+      const int           lo = stats->min_intensity[level][index];
+      const int           hi = stats->max_intensity[level][index];
+      if (lo < region->min_intensity) {
+        region->min_intensity = lo;
+      }
+      if (hi > region->max_intensity) {
+        region->max_intensity = hi;
+      }
+    }
+  }
+}
+
+void
+png2mesh_image_stats_add_pixel (const png2mesh_image_stats_t *stats,
+                                int x, int y,
+                                png2mesh_region_stats_t *region)
+{
+  png_byte           *pixel = NULL;
+  int                 intensity;
+
+  png2mesh_get_rgba (stats->image, x, y, &pixel);
+  intensity = pixel[0] + pixel[1] + pixel[2];
+  region->sum_rgb[0] += pixel[0];
+  region->sum_rgb[1] += pixel[1];
+  region->sum_rgb[2] += pixel[2];
+  region->num_matches += stats->match_mask[(size_t) y * stats->image->width + x];
+  region->num_pixels++;
+  if (intensity < region->min_intensity) {
+    region->min_intensity = intensity;
+  }
+  if (intensity > region->max_intensity) {
+    region->max_intensity = intensity;
+  }
+}
+
+void
+png2mesh_label_region_init (png2mesh_label_region_t *region)
+{
+  memset (region, 0, sizeof (*region));
+  region->min_label = PNG2MESH_MAX_LABELS;
+  region->max_label = -1;
+}
+
+void
+png2mesh_image_stats_add_label_rect (const png2mesh_image_stats_t *stats,
+                                     int x_start, int y_start, int x_end,
+                                     int y_end,
+                                     png2mesh_label_region_t *region)
+{
+  const int           width = stats->image->width;
+  int                 level, block, tx, ty;
+
+  assert (stats->labels != NULL);
+  assert (0 <= x_start && x_end <= stats->image->width);
+  assert (0 <= y_start && y_end <= stats->image->height);
+  if (x_end <= x_start || y_end <= y_start) {
+    return;
+  }
+  region->num_pixels += (uint64_t) (x_end - x_start) * (y_end - y_start);
+  if (stats->refine_label_sum != NULL) {
+    region->num_refine_label +=
+      png2mesh_image_stats_rect_sum (stats, stats->refine_label_sum, x_start,
+                                     y_start, x_end, y_end);
+  }
+
+  /* Cover the rectangle with (possibly overlapping) blocks. */
+  level =
+    png2mesh_image_stats_block_level (stats, x_start, y_start, x_end, y_end);
+  block = 1 << level;
+  for (ty = y_start; ty < y_end; ty += block) {
+    const int           y = ty + block <= y_end ? ty : y_end - block;
+    for (tx = x_start; tx < x_end; tx += block) {
+      const int           x = tx + block <= x_end ? tx : x_end - block;
+      const size_t        index = (size_t) y * width + x;
+      const int           lo = stats->min_label[level][index];
+      const int           hi = stats->max_label[level][index];
+      if (lo < region->min_label) {
+        region->min_label = lo;
+      }
+      if (hi > region->max_label) {
+        region->max_label = hi;
+      }
+    }
+  }
+}
+
+int
+png2mesh_label_region_refine (const png2mesh_label_region_t *region)
+{
+  return region->num_pixels > 0
+    && (region->min_label != region->max_label
+        || region->num_refine_label > 0);
+}
+
+void
+png2mesh_image_stats_count_labels (const png2mesh_image_stats_t *stats,
+                                   int x_start, int y_start, int x_end,
+                                   int y_end, uint64_t *label_counts)
+{
+  int                 x, y;
+
+  assert (stats->labels != NULL);
+  assert (0 <= x_start && x_end <= stats->image->width);
+  assert (0 <= y_start && y_end <= stats->image->height);
+  for (y = y_start; y < y_end; ++y) {
+    const unsigned char *row = stats->labels + (size_t) y * stats->image->width;
+    for (x = x_start; x < x_end; ++x) {
+      label_counts[row[x]]++;
+    }
+  }
+}
+
+int
+png2mesh_dominant_label (const uint64_t *label_counts, int num_labels)
+{
+  int                 ilabel, dominant = 0;
+
+  for (ilabel = 1; ilabel < num_labels; ++ilabel) {
+    if (label_counts[ilabel] > label_counts[dominant]) {
+      dominant = ilabel;
+    }
+  }
+  return dominant;
+}
@@ -0,0 +1,113 @@
+#ifndef PNG2MESH_IMAGE_STATS_H
+#define PNG2MESH_IMAGE_STATS_H
+
+#include <stdint.h>
+#include "png2mesh_readpng.h"
+
+/* Largest block level of the min/max tables. Level k stores the minimum and
+ * maximum r+g+b value of each 2^k x 2^k pixel block. Rectangles with both
+ * sides >= 2^k are answered with a constant number of lookups, larger
+ * rectangles are tiled with blocks of this size. */
+#define PNG2MESH_STATS_MAX_BLOCK_LEVEL 5
+
+/* Maximum number of labels of a label image, including the background label 0. */
+#define PNG2MESH_MAX_LABELS 64
+
+/* The summed-area tables we store per image. */
+typedef enum
+{
+  PNG2MESH_STATS_RED = 0,
+  PNG2MESH_STATS_GREEN,
+  PNG2MESH_STATS_BLUE,
+  PNG2MESH_STATS_MATCH,
+  PNG2MESH_STATS_NUM_SUMS
+} png2mesh_stats_sum_t;
+
+typedef struct
+{
+  const png2mesh_image_t *image;
+  const unsigned char *match_mask;      /* One value per pixel (row major), 1 if the pixel matches, 0 if not. Not owned. */
+  int                 stride;   /* Row length of the summed-area tables (width + 1). */
+  /* Summed-area tables of size (width + 1) x (height + 1).
+   * sum[i][y * stride + x] is the sum over all pixels with coordinates < (x, y). */
+  uint64_t           *sum[PNG2MESH_STATS_NUM_SUMS];
+  int                 num_levels;       /* Number of min/max block levels. */
+  uint16_t          **min_intensity;    /* min_intensity[k][y * width + x] is the minimum r+g+b in the 2^k block starting at (x, y). */
+  uint16_t          **max_intensity;    /* Same for the maximum. */
+  const unsigned char *labels;  /* One label per pixel (row major), NULL if the image is not labeled. Not owned. */
+  int                 num_labels;       /* Number of labels. 0 if labels is NULL. */
+  unsigned char     **min_label;        /* Block tables of the minimum label, with the same levels as min_intensity. */
+  unsigned char     **max_label;        /* Same for the maximum label. */
+  int                 refine_label;     /* The label to count, -1 if none. */
+  uint64_t           *refine_label_sum; /* Summed-area table counting the pixels with refine_label. NULL if refine_label < 0. */
+} png2mesh_image_stats_t;
+
+/* Statistics accumulated over a set of pixels. */
+typedef struct
+{
+  uint64_t            sum_rgb[3];
+  uint64_t            num_matches;
+  uint64_t            num_pixels;
+  int                 min_intensity;    /* Minimum r+g+b. Only valid if num_pixels > 0. */
+  int                 max_intensity;    /* Maximum r+g+b. Only valid if num_pixels > 0. */
+} png2mesh_region_stats_t;
+
+/* Label statistics accumulated over a set of pixels of a labeled image. */
+typedef struct
+{
+  uint64_t            num_pixels;
+  uint64_t            num_refine_label; /* Number of pixels with the label stats->refine_label. */
+  int                 min_label;        /* Minimum label. Only valid if num_pixels > 0. */
+  int                 max_label;        /* Maximum label. Only valid if num_pixels > 0. */
+} png2mesh_label_region_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Build the summed-area and min/max tables of an image.
+ * labels may be NULL, otherwise it holds one value < num_labels <= PNG2MESH_MAX_LABELS
+ * per pixel and we additionally build min/max tables of the labels and,
+ * if refine_label >= 0, a summed-area table counting the pixels with refine_label.
+ * match_mask and labels must stay valid until the stats are destroyed.
+ * Returns NULL if memory allocation fails. */
+png2mesh_image_stats_t *png2mesh_image_stats_new (const png2mesh_image_t *image,
+                                                  const unsigned char *match_mask,
+                                                  const unsigned char *labels,
+                                                  int num_labels,
+                                                  int refine_label);
+void png2mesh_image_stats_destroy (png2mesh_image_stats_t *stats);
+
+/* Reset a region to contain no pixels. */
+void png2mesh_region_stats_init (png2mesh_region_stats_t *region);
+/* Add all pixels x_start <= x < x_end, y_start <= y < y_end to a region. */
+void png2mesh_image_stats_add_rect (const png2mesh_image_stats_t *stats,
+                                    int x_start, int y_start, int x_end, int y_end,
+                                    png2mesh_region_stats_t *region);
+/* Add a single pixel to a region. */
+void png2mesh_image_stats_add_pixel (const png2mesh_image_stats_t *stats,
+                                     int x, int y,
+                                     png2mesh_region_stats_t *region);
+
+/* Reset a label region to contain no pixels. */
+void png2mesh_label_region_init (png2mesh_label_region_t *region);
+/* Add all pixels x_start <= x < x_end, y_start <= y < y_end of a labeled image to a label region. */
+void png2mesh_image_stats_add_label_rect (const png2mesh_image_stats_t *stats,
+                                          int x_start, int y_start, int x_end, int y_end,
+                                          png2mesh_label_region_t *region);
+/* Return true if a label region contains more than one label or the label stats->refine_label. */
+int png2mesh_label_region_refine (const png2mesh_label_region_t *region);
+/* Add the number of pixels per label in x_start <= x < x_end, y_start <= y < y_end
+ * to label_counts, which has stats->num_labels entries.
+ * This loops over all pixels and is meant for the output only. */
+void png2mesh_image_stats_count_labels (const png2mesh_image_stats_t *stats,
+                                        int x_start, int y_start, int x_end, int y_end,
+                                        uint64_t *label_counts);
+/* Return the label with the most pixels. Ties go to the smaller label. */
+int png2mesh_dominant_label (const uint64_t *label_counts, int num_labels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
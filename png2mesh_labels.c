@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "png2mesh_labels.h"
+
+int
+png2mesh_parse_palette (const char *palette_string,
+                        png2mesh_palette_t *palette)
+{
+  const char         *pos = palette_string;
+  int                 ichannel;
+
+  palette->num_colors = 0;
+  while (*pos != '\0') {
+    if (palette->num_colors >= PNG2MESH_MAX_LABELS - 1) {
+      /* Too many colors. */
+      return -1;
+    }
+    for (ichannel = 0; ichannel < 3; ++ichannel) {
+      int                 value;
+      int                 num_read;
+      if (ichannel > 0) {
+        if (*pos != ',') {
+          return -1;
+        }
+        ++pos;
+      }
+      /* %d would skip leading whitespace and accept a sign. */
+      if (!isdigit ((unsigned char) *pos)
+          || sscanf (pos, "%d%n", &value, &num_read) != 1
+          || value < 0 || 255 < value) {
+        return -1;
+      }
+      palette->colors[palette->num_colors][ichannel] = value;
+      pos += num_read;
+    }
+    palette->num_colors++;
+    if (*pos == ':' && *(pos + 1) != '\0') {
+      ++pos;
+    }
+    else if (*pos != '\0') {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+unsigned char *
+png2mesh_build_label_image (const png2mesh_image_t *image,
+                            const png2mesh_palette_t *palette)
+{
+  unsigned char      *labels =
+    (unsigned char *) malloc ((size_t) image->width * image->height);
+  int                 x, y, icolor;
+
+  if (labels == NULL) {
+    return NULL;
+  }
+  for (y = 0; y < image->height; ++y) {
+    for (x = 0; x < image->width; ++x) {
+      png_byte           *pixel = NULL;
+      png2mesh_get_rgba (image, x, y, &pixel);
+      labels[(size_t) y * image->width + x] = 0;
+      for (icolor = 0; icolor < palette->num_colors; ++icolor) {
+        const int          *color = palette->colors[icolor];
+        if (abs (pixel[0] - color[0]) <= palette->tolerance
+            && abs (pixel[1] - color[1]) <= palette->tolerance
+            && abs (pixel[2] - color[2]) <= palette->tolerance) {
+          labels[(size_t) y * image->width + x] = icolor + 1;
+          break;
+        }
+      }
+    }
+  }
+  return labels;
+}
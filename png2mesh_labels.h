@@ -0,0 +1,35 @@
+#ifndef PNG2MESH_LABELS_H
+#define PNG2MESH_LABELS_H
+
+#include "png2mesh_readpng.h"
+#include "png2mesh_image_stats.h"
+
+/* A list of colors for the label mode. Pixels matching the i-th color get label i + 1,
+ * all other pixels get the background label 0. */
+typedef struct
+{
+  int                 num_colors;
+  int                 colors[PNG2MESH_MAX_LABELS - 1][3];
+  int                 tolerance;        /* A pixel matches a color if each channel differs by at most tolerance. */
+} png2mesh_palette_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parse a palette string of the form "R,G,B:R,G,B:...".
+ * All values are decimal (leading zeros are allowed) without whitespace.
+ * An empty string gives an empty palette. The tolerance is not touched.
+ * Returns 0 on success and -1 if the string is not a valid palette. */
+int png2mesh_parse_palette (const char *palette_string, png2mesh_palette_t *palette);
+/* Classify each pixel by the first matching color of the palette.
+ * Returns one label per pixel in row major order, to be freed with free,
+ * or NULL if memory allocation fails. */
+unsigned char *png2mesh_build_label_image (const png2mesh_image_t *image,
+                                           const png2mesh_palette_t *palette);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../png2mesh_readpng.h"
+#include "../png2mesh_image_stats.h"
+#include "../png2mesh_labels.h"
+
+/* Check that parsing a palette string succeeds or fails as expected. */
+static int check_parse (const char *palette_string, int expect_valid, int expect_num_colors)
+{
+    png2mesh_palette_t palette;
+    const int valid = png2mesh_parse_palette (palette_string, &palette) == 0;
+
+    if (valid != expect_valid || (valid && palette.num_colors != expect_num_colors)) {
+        fprintf (stderr, "ERROR: Palette '%s' should be %s.\n", palette_string,
+                 expect_valid ? "valid" : "invalid");
+        return 1;
+    }
+    return 0;
+}
+
+/* Build an RGB image of the given size with all pixels black. */
+static png2mesh_image_t *new_image (int width, int height)
+{
+    png2mesh_image_t *image = (png2mesh_image_t *) calloc (1, sizeof (png2mesh_image_t));
+    image->width = width;
+    image->height = height;
+    image->num_values_per_pixel = 3;
+    image->color_type = PNG_COLOR_TYPE_RGB;
+    image->filename = "synthetic";
+    image->rgba_values = (png_bytep *) malloc (height * sizeof (png_bytep));
+    for (int y = 0; y < height; ++y) {
+        image->rgba_values[y] = (png_byte *) calloc (3 * width, 1);
+    }
+    return image;
+}
+
+static void set_pixel (png2mesh_image_t *image, int x, int y, int r, int g, int b)
+{
+    png_byte *RGBA;
+    png2mesh_get_rgba (image, x, y, &RGBA);
+    RGBA[0] = r;
+    RGBA[1] = g;
+    RGBA[2] = b;
+}
+
+static void destroy_image (png2mesh_image_t *image)
+{
+    for (int y = 0; y < image->height; ++y) {
+        free (image->rgba_values[y]);
+    }
+    free (image->rgba_values);
+    free (image);
+}
+
+/* Check whether the rectangle [x_start, x_end) x [y_start, y_end) is marked for refinement. */
+static int check_refine (const png2mesh_image_stats_t *stats, int x_start, int y_start, int x_end, int y_end,
+                         int expect_refine)
+{
+    png2mesh_label_region_t region;
+
+    png2mesh_label_region_init (&region);
+    png2mesh_image_stats_add_label_rect (stats, x_start, y_start, x_end, y_end, &region);
+    if (png2mesh_label_region_refine (&region) != expect_refine) {
+        fprintf (stderr, "ERROR: Rectangle [%i, %i) x [%i, %i) with refine label %i should %sbe refined.\n",
+                 x_start, x_end, y_start, y_end, stats->refine_label, expect_refine ? "" : "not ");
+        return 1;
+    }
+    return 0;
+}
+
+int main () {
+    int num_errors = 0;
+    char many_colors[64 * 12 + 1];
+    png2mesh_palette_t palette;
+
+    /* Palette parsing. */
+    num_errors += check_parse ("", 1, 0);
+    num_errors += check_parse ("255,0,0", 1, 1);
+    num_errors += check_parse ("1,2,3:4,5,6:7,8,9", 1, 3);
+    num_errors += check_parse ("090,0,0", 1, 1);
+    num_errors += check_parse ("255,0,0:", 0, 0);
+    num_errors += check_parse (":", 0, 0);
+    num_errors += check_parse ("1,2", 0, 0);
+    num_errors += check_parse ("1,2,3x", 0, 0);
+    num_errors += check_parse ("256,0,0", 0, 0);
+    num_errors += check_parse ("-1,0,0", 0, 0);
+    num_errors += check_parse ("+1,0,0", 0, 0);
+    num_errors += check_parse (" 1,2,3", 0, 0);
+    num_errors += check_parse ("1, 2,3", 0, 0);
+    num_errors += check_parse ("0x10,0,0", 0, 0);
+    /* Zero padded values are decimal, not octal. */
+    png2mesh_parse_palette ("128,064,032", &palette);
+    if (palette.colors[0][0] != 128 || palette.colors[0][1] != 64 || palette.colors[0][2] != 32) {
+        fprintf (stderr, "ERROR: Palette '128,064,032' parsed as %i,%i,%i.\n",
+                 palette.colors[0][0], palette.colors[0][1], palette.colors[0][2]);
+        num_errors++;
+    }
+    /* At most PNG2MESH_MAX_LABELS - 1 colors. */
+    many_colors[0] = '\0';
+    for (int icolor = 0; icolor < PNG2MESH_MAX_LABELS - 1; ++icolor) {
+        strcat (many_colors, icolor == 0 ? "1,2,3" : ":1,2,3");
+    }
+    num_errors += check_parse (many_colors, 1, PNG2MESH_MAX_LABELS - 1);
+    strcat (many_colors, ":1,2,3");
+    num_errors += check_parse (many_colors, 0, 0);
+
+    /* Label image: First match wins and the tolerance is inclusive. */
+    {
+        const int expected[6] = { 1, 1, 2, 0, 0, 2 };
+        png2mesh_image_t *image = new_image (6, 1);
+        unsigned char *labels;
+
+        set_pixel (image, 0, 0, 104, 100, 100); /* Matches both colors. */
+        set_pixel (image, 1, 0, 110, 100, 100); /* Exactly the tolerance away from color 1. */
+        set_pixel (image, 2, 0, 112, 100, 100); /* Only matches color 2. */
+        set_pixel (image, 3, 0, 116, 100, 100); /* Matches none. */
+        set_pixel (image, 4, 0, 0, 0, 0);
+        set_pixel (image, 5, 0, 115, 90, 100);  /* Only matches color 2, with differences in two channels. */
+        png2mesh_parse_palette ("100,100,100:105,100,100", &palette);
+        palette.tolerance = 10;
+        labels = png2mesh_build_label_image (image, &palette);
+        for (int x = 0; x < image->width; ++x) {
+            if (labels[x] != expected[x]) {
+                fprintf (stderr, "ERROR: Pixel %i has label %i instead of %i.\n", x, labels[x], expected[x]);
+                num_errors++;
+            }
+        }
+        free (labels);
+        destroy_image (image);
+    }
+
+    /* Refinement marking: Left half red, right half blue, a green square at (8, 8). */
+    {
+        png2mesh_image_t *image = new_image (64, 64);
+        unsigned char *match_mask = (unsigned char *) calloc (64 * 64, 1);
+        unsigned char *labels;
+        png2mesh_image_stats_t *stats;
+        uint64_t label_counts[PNG2MESH_MAX_LABELS] = { 0 };
+
+        for (int y = 0; y < 64; ++y) {
+            for (int x = 0; x < 64; ++x) {
+                set_pixel (image, x, y, x < 32 ? 255 : 0, 0, x < 32 ? 0 : 255);
+            }
+        }
+        for (int y = 8; y < 12; ++y) {
+            for (int x = 8; x < 12; ++x) {
+                set_pixel (image, x, y, 0, 255, 0);
+            }
+        }
+        png2mesh_parse_palette ("255,0,0:0,0,255:0,255,0", &palette);
+        palette.tolerance = 0;
+        labels = png2mesh_build_label_image (image, &palette);
+
+        /* Only refine at interfaces. */
+        stats = png2mesh_image_stats_new (image, match_mask, labels, palette.num_colors + 1, -1);
+        num_errors += check_refine (stats, 16, 16, 32, 64, 0);
+        num_errors += check_refine (stats, 32, 0, 64, 64, 0);
+        num_errors += check_refine (stats, 0, 16, 64, 64, 1);
+        num_errors += check_refine (stats, 31, 40, 33, 41, 1);
+        num_errors += check_refine (stats, 0, 0, 16, 16, 1);
+        num_errors += check_refine (stats, 8, 8, 12, 12, 0);
+        num_errors += check_refine (stats, 5, 5, 5, 5, 0);
+        png2mesh_image_stats_count_labels (stats, 16, 0, 64, 64, label_counts);
+        if (png2mesh_dominant_label (label_counts, stats->num_labels) != 2) {
+            fprintf (stderr, "ERROR: Dominant label of [16, 64) x [0, 64) should be 2.\n");
+            num_errors++;
+        }
+        png2mesh_image_stats_destroy (stats);
+
+        /* Additionally refine all elements containing blue. */
+        stats = png2mesh_image_stats_new (image, match_mask, labels, palette.num_colors + 1, 2);
+        num_errors += check_refine (stats, 16, 16, 32, 64, 0);
+        num_errors += check_refine (stats, 32, 0, 64, 64, 1);
+        num_errors += check_refine (stats, 63, 63, 64, 64, 1);
+        num_errors += check_refine (stats, 8, 8, 12, 12, 0);
+        png2mesh_image_stats_destroy (stats);
+
+        free (labels);
+        free (match_mask);
+        destroy_image (image);
+    }
+
+    printf ("Checked label mode with %i errors.\n", num_errors);
+    return num_errors != 0;
+}
@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../png2mesh_readpng.h"
+#include "../png2mesh_image_stats.h"
+
+/* Compare the table based rectangle statistics with a pixel by pixel loop. */
+static int check_rect (const png2mesh_image_stats_t *stats, int x_start, int y_start, int x_end, int y_end)
+{
+    png2mesh_region_stats_t from_tables, from_pixels;
+    png2mesh_label_region_t labels_from_tables, labels_from_pixels;
+    uint64_t label_counts[PNG2MESH_MAX_LABELS] = { 0 };
+    uint64_t label_counts_from_pixels[PNG2MESH_MAX_LABELS] = { 0 };
+
+    png2mesh_region_stats_init (&from_tables);
+    png2mesh_region_stats_init (&from_pixels);
+    png2mesh_label_region_init (&labels_from_tables);
+    png2mesh_label_region_init (&labels_from_pixels);
+    png2mesh_image_stats_add_rect (stats, x_start, y_start, x_end, y_end, &from_tables);
+    png2mesh_image_stats_add_label_rect (stats, x_start, y_start, x_end, y_end, &labels_from_tables);
+    png2mesh_image_stats_count_labels (stats, x_start, y_start, x_end, y_end, label_counts);
+    for (int y = y_start; y < y_end; ++y) {
+        for (int x = x_start; x < x_end; ++x) {
+            const int label = stats->labels[(size_t) y * stats->image->width + x];
+            png2mesh_image_stats_add_pixel (stats, x, y, &from_pixels);
+            label_counts_from_pixels[label]++;
+            labels_from_pixels.num_pixels++;
+            labels_from_pixels.num_refine_label += label == stats->refine_label;
+            if (label < labels_from_pixels.min_label) labels_from_pixels.min_label = label;
+            if (label > labels_from_pixels.max_label) labels_from_pixels.max_label = label;
+        }
+    }
+    if (from_tables.num_pixels != from_pixels.num_pixels
+        || from_tables.num_matches != from_pixels.num_matches
+        || from_tables.sum_rgb[0] != from_pixels.sum_rgb[0]
+        || from_tables.sum_rgb[1] != from_pixels.sum_rgb[1]
+        || from_tables.sum_rgb[2] != from_pixels.sum_rgb[2]
+        || from_tables.min_intensity != from_pixels.min_intensity
+        || from_tables.max_intensity != from_pixels.max_intensity
+        || memcmp (&labels_from_tables, &labels_from_pixels, sizeof (labels_from_tables))
+        || memcmp (label_counts, label_counts_from_pixels, sizeof (label_counts))) {
+        fprintf (stderr, "ERROR: Statistics of rectangle [%i, %i) x [%i, %i) differ.\n",
+                 x_start, x_end, y_start, y_end);
+        return 1;
+    }
+    return 0;
+}
+
+int main () {
+    png2mesh_image_t *pngimage;
+    png2mesh_image_stats_t *stats;
+    unsigned char *match_mask;
+    unsigned char *labels;
+    const char *filename = "../examples/heart.png";
+    int num_errors = 0;
+
+    pngimage = png2mesh_read_png (filename);
+    if (pngimage == NULL) {
+        fprintf (stderr, "ERROR: Could not read image %s.\n", filename);
+        return 1;
+    }
+    match_mask = (unsigned char *) malloc ((size_t) pngimage->width * pngimage->height);
+    labels = (unsigned char *) malloc ((size_t) pngimage->width * pngimage->height);
+    for (int y = 0; y < pngimage->height; ++y) {
+        for (int x = 0; x < pngimage->width; ++x) {
+            png_byte *RGBA;
+            png2mesh_get_rgba (pngimage, x, y, &RGBA);
+            match_mask[(size_t) y * pngimage->width + x] = RGBA[0] + RGBA[1] + RGBA[2] <= 255;
+            /* Three labels: dark, medium and bright pixels. */
+            labels[(size_t) y * pngimage->width + x] = (RGBA[0] + RGBA[1] + RGBA[2]) / 256;
+        }
+    }
+    stats = png2mesh_image_stats_new (pngimage, match_mask, labels, 3, 2);
+    if (stats == NULL) {
+        fprintf (stderr, "ERROR: Could not build statistics of image %s.\n", filename);
+        return 1;
+    }
+
+    srand (0);
+    for (int irect = 0; irect < 200; ++irect) {
+        const int x0 = rand () % pngimage->width, x1 = rand () % (pngimage->width + 1);
+        const int y0 = rand () % pngimage->height, y1 = rand () % (pngimage->height + 1);
+        num_errors += check_rect (stats, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+                                  x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0);
+    }
+    num_errors += check_rect (stats, 0, 0, pngimage->width, pngimage->height);
+    num_errors += check_rect (stats, 17, 3, 18, 4);
+    printf ("Checked image statistics of %s with %i errors.\n", filename, num_errors);
+
+    png2mesh_image_stats_destroy (stats);
+    free (match_mask);
+    free (labels);
+    png2mesh_image_cleanup (pngimage);
+
+    return num_errors != 0;
+}